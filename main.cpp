@@ -1,14 +1,20 @@
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <fcntl.h>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <sstream>
 #include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "external/chess.hpp"
@@ -55,6 +61,14 @@ using fens_depthIndex_t = std::vector<fen_set_t *>;
 
 using poslist_t = std::map<PackedBoard, int>;
 
+// offset of a position's record in the data section of the subtree index
+using offset_map_t = phmap::parallel_flat_hash_map<
+    PackedBoard, std::uint64_t, std::hash<PackedBoard>,
+    std::equal_to<PackedBoard>,
+    std::allocator<std::pair<PackedBoard, std::uint64_t>>, 8, std::mutex>;
+
+using db_result_t = std::vector<std::pair<std::string, int>>;
+
 inline size_t count_unseen_edges(const unseen_map_t &map) {
   size_t sum = 0;
   for (const auto &pair : map)
@@ -116,10 +130,392 @@ struct Stats {
   std::atomic<size_t> gets;
   std::atomic<size_t> hits;
   std::atomic<size_t> nodes;
+  std::atomic<size_t> reused;
 
-  void clear() { gets = hits = nodes = 0; };
+  void clear() { gets = hits = nodes = reused = 0; };
 };
 
+// Persistent index of the DB results seen during a run. A later run against a
+// newer dump can reuse these results for all positions not listed as changed,
+// and only needs to probe the DB for the others.
+// File layout: magic, format version, number of entries, number of bucket
+// bits, bucket table, entries grouped by bucket, data records. The bucket of a
+// key is given by the top bits of its hash, and the bucket table holds the
+// index of the first entry of each bucket, so a lookup scans only a few
+// entries.
+// A data record stores the number of moves, the ply and the (move, score)
+// pairs, with moves encoded as chess::Move.
+class SubtreeIndex {
+public:
+  struct Entry {
+    PackedBoard key;
+    std::uint64_t offset;
+  };
+  static_assert(sizeof(Entry) == 32);
+
+  ~SubtreeIndex() {
+    if (map_base)
+      munmap(map_base, map_size);
+  }
+
+  // memory map the index saved by an earlier run
+  bool load(const std::string &filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < header_size) {
+      close(fd);
+      return false;
+    }
+
+    map_size = st.st_size;
+    map_base = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map_base == MAP_FAILED) {
+      map_base = nullptr;
+      return false;
+    }
+    madvise(map_base, map_size, MADV_RANDOM);
+
+    const char *base = static_cast<const char *>(map_base);
+    std::uint64_t file_version;
+    std::memcpy(&file_version, base + sizeof(magic), sizeof(file_version));
+    std::memcpy(&n_entries, base + sizeof(magic) + sizeof(file_version),
+                sizeof(n_entries));
+    std::memcpy(&bucket_bits,
+                base + sizeof(magic) + sizeof(file_version) + sizeof(n_entries),
+                sizeof(bucket_bits));
+    size_t table_size = ((std::uint64_t(1) << (bucket_bits & 63)) + 1) *
+                        sizeof(std::uint64_t);
+    if (std::memcmp(base, magic, sizeof(magic)) != 0 ||
+        file_version != version || bucket_bits > max_bucket_bits ||
+        table_size > map_size - header_size ||
+        n_entries > (map_size - header_size - table_size) / sizeof(Entry)) {
+      munmap(map_base, map_size);
+      map_base = nullptr;
+      return false;
+    }
+
+    buckets = reinterpret_cast<const std::uint64_t *>(base + header_size);
+    entries = reinterpret_cast<const Entry *>(base + header_size + table_size);
+    data = reinterpret_cast<const std::uint8_t *>(entries + n_entries);
+    data_size = map_size - header_size - table_size - n_entries * sizeof(Entry);
+    return true;
+  }
+
+  // read the positions (one fen or epd per line) whose DB entry differs
+  // between the dump used for the loaded index and the current one
+  std::optional<size_t> load_changed(const std::string &filename) {
+    std::ifstream cfile(filename);
+    if (!cfile.is_open())
+      return std::nullopt;
+
+    std::string line;
+    size_t line_number = 0;
+    while (std::getline(cfile, line)) {
+      line_number++;
+      if (line.empty())
+        continue;
+
+      auto board = normalized_board(line);
+      if (!board) {
+        std::cout << "Invalid fen on line " << line_number << " of "
+                  << filename << ": " << line << std::endl;
+        return std::nullopt;
+      }
+      changed.insert(Board::Compact::encode(*board));
+    }
+
+    if (cfile.bad())
+      return std::nullopt;
+
+    return changed.size();
+  }
+
+  // the board for a fen as the traversal would reach it: makeMove<true> only
+  // sets the en passant square if the capture is legal, while fens usually
+  // name it after every double pawn push. Returns nothing for a malformed
+  // fen, which chess.hpp does not check.
+  static std::optional<Board> normalized_board(const std::string &fen) {
+    std::istringstream fields(fen);
+    std::string position, stm, castling, ep;
+    if (!(fields >> position >> stm >> castling >> ep))
+      return std::nullopt;
+
+    int ranks = 1, files = 0, white_kings = 0, black_kings = 0;
+    for (char c : position) {
+      if (c == '/') {
+        if (files != 8)
+          return std::nullopt;
+        ranks++;
+        files = 0;
+      } else if (c >= '1' && c <= '8')
+        files += c - '0';
+      else if (std::string_view("pnbrqkPNBRQK").find(c) !=
+               std::string_view::npos) {
+        files++;
+        white_kings += c == 'K';
+        black_kings += c == 'k';
+      } else
+        return std::nullopt;
+
+      if (files > 8)
+        return std::nullopt;
+    }
+    if (ranks != 8 || files != 8 || white_kings != 1 || black_kings != 1)
+      return std::nullopt;
+
+    if ((stm != "w" && stm != "b") ||
+        (castling != "-" &&
+         castling.find_first_not_of("KQkq") != std::string::npos))
+      return std::nullopt;
+
+    if (ep != "-" && (ep.size() != 2 || ep[0] < 'a' || ep[0] > 'h' ||
+                      ep[1] != (stm == "w" ? '6' : '3')))
+      return std::nullopt;
+
+    Board board(position + " " + stm + " " + castling + " " + ep);
+    if (board.enpassantSq() == Square::underlying::NO_SQ)
+      return board;
+
+    Movelist moves;
+    movegen::legalmoves(moves, board);
+    for (const auto &m : moves)
+      if (m.typeOf() == Move::ENPASSANT)
+        return board;
+
+    return Board(position + " " + stm + " " + castling + " -");
+  }
+
+  // collect the DB results of this run, to be written by save()
+  bool start_saving(const std::string &filename) {
+    save_name = filename;
+    data_file.open(save_name + ".data.tmp", std::ios::binary);
+    return data_file.is_open();
+  }
+
+  bool is_saving() const { return !save_name.empty(); }
+
+  // write the index, replacing the file only once complete so that it
+  // can be the same as the one loaded. Returns the number of positions, or
+  // nothing if writing failed, in which case no file is left behind.
+  std::optional<size_t> save() {
+    std::string data_name = save_name + ".data.tmp";
+    std::string tmp_name = save_name + ".tmp";
+
+    data_file.close();
+    if (data_file.fail()) {
+      std::remove(data_name.c_str());
+      return std::nullopt;
+    }
+
+    // release each submap once copied, so that the map and the vector are
+    // not both fully in memory
+    std::vector<Entry> sorted;
+    sorted.reserve(saved.size());
+    for (size_t i = 0; i < saved.subcnt(); ++i)
+      saved.with_submap_m(i, [&sorted](offset_map_t::EmbeddedSet &set) {
+        for (const auto &pair : set)
+          sorted.push_back({pair.first, pair.second});
+        offset_map_t::EmbeddedSet().swap(set);
+      });
+    std::sort(sorted.begin(), sorted.end(),
+              [](const Entry &a, const Entry &b) {
+                auto ha = key_hash(a.key), hb = key_hash(b.key);
+                return ha < hb || (ha == hb && a.key < b.key);
+              });
+
+    std::uint64_t count = sorted.size();
+
+    // about 4 entries per bucket
+    std::uint64_t n_bits = 0;
+    while (n_bits < max_bucket_bits && (std::uint64_t(4) << n_bits) < count)
+      n_bits++;
+    std::vector<std::uint64_t> table((std::uint64_t(1) << n_bits) + 1, 0);
+    for (const auto &entry : sorted)
+      table[bucket_of(entry.key, n_bits) + 1]++;
+    for (size_t i = 1; i < table.size(); i++)
+      table[i] += table[i - 1];
+
+    std::ofstream ofile(tmp_name, std::ios::binary);
+    ofile.write(magic, sizeof(magic));
+    ofile.write(reinterpret_cast<const char *>(&version), sizeof(version));
+    ofile.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    ofile.write(reinterpret_cast<const char *>(&n_bits), sizeof(n_bits));
+    ofile.write(reinterpret_cast<const char *>(table.data()),
+                table.size() * sizeof(std::uint64_t));
+    ofile.write(reinterpret_cast<const char *>(sorted.data()),
+                count * sizeof(Entry));
+
+    // an empty data section is valid, but operator<< fails on it
+    std::ifstream dfile(data_name, std::ios::binary);
+    if (data_offset > 0)
+      ofile << dfile.rdbuf();
+    bool ok = dfile.is_open() && ofile.good();
+    dfile.close();
+    ofile.close();
+    ok = ok && !ofile.fail();
+
+    std::remove(data_name.c_str());
+    if (!ok || std::rename(tmp_name.c_str(), save_name.c_str()) != 0) {
+      std::remove(tmp_name.c_str());
+      return std::nullopt;
+    }
+
+    return count;
+  }
+
+  // the DB result for this position, from the loaded index if it is
+  // unchanged, otherwise from the DB
+  db_result_t get(const std::uintptr_t handle, const Board &board,
+                  Stats &stats) {
+    PackedBoard key = Board::Compact::encode(board);
+    db_result_t result;
+
+    if (map_base && !changed.contains(key) && lookup(key, result))
+      stats.reused++;
+    else {
+      result = cdbdirect_get(handle, board.getFen(false));
+      stats.gets++;
+    }
+
+    if (is_saving())
+      store(key, board, result);
+
+    return result;
+  }
+
+private:
+  static constexpr char magic[8] = {'C', 'D', 'B', 'S', 'T', 'I', 'D', 'X'};
+  // bump whenever the layout of the file changes
+  static constexpr std::uint64_t version = 2;
+  static constexpr size_t header_size =
+      sizeof(magic) + 3 * sizeof(std::uint64_t);
+  static constexpr std::uint64_t max_bucket_bits = 40;
+
+  // fixed by the file format, unlike std::hash<PackedBoard>
+  static std::uint64_t key_hash(const PackedBoard &key) {
+    std::uint64_t h = 0;
+    for (size_t i = 0; i < key.size(); i += sizeof(h)) {
+      std::uint64_t word;
+      std::memcpy(&word, key.data() + i, sizeof(word));
+      h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+      h ^= h >> 32;
+    }
+    h *= 0xFF51AFD7ED558CCDULL;
+    return h ^ (h >> 33);
+  }
+
+  // same as uci::moveToUci, which is dominated by its use of a stringstream
+  static std::string move_to_uci(const Move &move) {
+    int from = move.from().index(), to = move.to().index();
+    if (move.typeOf() == Move::CASTLING)
+      to = (from & ~7) + (to > from ? 6 : 2);
+
+    std::string uci = {char('a' + (from & 7)), char('1' + (from >> 3)),
+                       char('a' + (to & 7)), char('1' + (to >> 3))};
+    if (move.typeOf() == Move::PROMOTION)
+      uci += "nbrq"[(move.move() >> 12) & 3];
+    return uci;
+  }
+
+  static std::uint64_t bucket_of(const PackedBoard &key, std::uint64_t bits) {
+    return bits ? key_hash(key) >> (64 - bits) : 0;
+  }
+
+  // record: n_moves (uint8), ply (int16), n_moves x (move (uint16), score
+  // (int16)), the trailing "a0a0" entry of the DB result holds the ply.
+  // A record not fully inside the file is treated as a miss.
+  bool lookup(const PackedBoard &key, db_result_t &result) const {
+    std::uint64_t b = bucket_of(key, bucket_bits);
+    std::uint64_t first = buckets[b], last = buckets[b + 1];
+    if (first > last || last > n_entries)
+      return false;
+
+    auto it = std::find_if(entries + first, entries + last,
+                           [&key](const Entry &e) { return e.key == key; });
+    if (it == entries + last || it->offset >= data_size ||
+        data_size - it->offset < 3)
+      return false;
+
+    const std::uint8_t *p = data + it->offset;
+    std::uint8_t n_moves = p[0];
+    if (data_size - it->offset < 3 + 4 * size_t(n_moves))
+      return false;
+    std::int16_t ply;
+    std::memcpy(&ply, p + 1, sizeof(ply));
+    p += 3;
+
+    result.reserve(n_moves + 1);
+    for (int i = 0; i < n_moves; i++, p += 4) {
+      std::uint16_t move;
+      std::int16_t score;
+      std::memcpy(&move, p, sizeof(move));
+      std::memcpy(&score, p + 2, sizeof(score));
+      result.emplace_back(move_to_uci(Move(move)), score);
+    }
+    result.emplace_back("a0a0", ply);
+    return true;
+  }
+
+  void store(const PackedBoard &key, const Board &board,
+             const db_result_t &result) {
+    if (saved.contains(key))
+      return;
+
+    std::uint8_t n_moves = result.size() - 1;
+    std::int16_t ply = result.back().second;
+    std::vector<char> record(3 + 4 * n_moves);
+    record[0] = n_moves;
+    std::memcpy(&record[1], &ply, sizeof(ply));
+    for (int i = 0; i < n_moves; i++) {
+      std::uint16_t move = uci::uciToMove(board, result[i].first).move();
+      std::int16_t score = result[i].second;
+      std::memcpy(&record[3 + 4 * i], &move, sizeof(move));
+      std::memcpy(&record[5 + 4 * i], &score, sizeof(score));
+    }
+
+    saved.lazy_emplace_l(
+        key, [](offset_map_t::value_type &p) {},
+        [&](const offset_map_t::constructor &ctor) {
+          std::lock_guard<std::mutex> lock(data_mutex);
+          ctor(key, data_offset);
+          data_file.write(record.data(), record.size());
+          data_offset += record.size();
+        });
+  }
+
+  // loaded index
+  void *map_base = nullptr;
+  size_t map_size = 0;
+  const std::uint64_t *buckets = nullptr;
+  std::uint64_t bucket_bits = 0;
+  const Entry *entries = nullptr;
+  std::uint64_t n_entries = 0;
+  const std::uint8_t *data = nullptr;
+  size_t data_size = 0;
+  fen_set_t changed;
+
+  // index being saved
+  std::string save_name;
+  offset_map_t saved;
+  std::ofstream data_file;
+  std::uint64_t data_offset = 0;
+  std::mutex data_mutex;
+};
+
+// probe the DB, going through the subtree index if one is used
+db_result_t probe(const std::uintptr_t handle, const Board &board,
+                  Stats &stats, SubtreeIndex *index) {
+  if (index)
+    return index->get(handle, board, stats);
+
+  stats.gets++;
+  return cdbdirect_get(handle, board.getFen(false));
+}
+
 // returns an index that signifies progress during a chess game,
 // this index will never increase during a game.
 // it ranges from 3006 to 0.
@@ -162,7 +558,8 @@ int get_eval_gap(int pos_eval, int child_move_eval) {
 std::tuple<std::uint8_t, std::int16_t, int>
 count_unseen_moves(Board &board,
                    std::vector<std::pair<std::string, int>> &result,
-                   const std::uintptr_t handle, Stats &stats) {
+                   const std::uintptr_t handle, Stats &stats,
+                   SubtreeIndex *index) {
   std::tuple<std::uint8_t, std::int16_t, int> count_unseen = {0, 0, 0};
   Movelist moves;
   movegen::legalmoves(moves, board);
@@ -180,8 +577,7 @@ count_unseen_moves(Board &board,
 
     if (it == result.end()) {
       board.makeMove<true>(m);
-      auto r = cdbdirect_get(handle, board.getFen(false));
-      stats.gets++;
+      auto r = probe(handle, board, stats, index);
       if (r.back().second != -2) {
         if (std::get<0>(count_unseen) == 0) {
           std::get<1>(count_unseen) = result.front().second;
@@ -206,7 +602,8 @@ void explore(const fen_set_t::EmbeddedSet &fen_list, int depth,
              const std::uintptr_t handle, Stats &stats, fen_set_t &visited_keys,
              fens_depthIndex_t &fens_depthIndex,
              fens_progressIndex_t &fens_progressIndex, const int maxCPLoss,
-             unseen_map_t *fens_with_unseen, int root_ply_depth) {
+             unseen_map_t *fens_with_unseen, int root_ply_depth,
+             SubtreeIndex *index) {
 
   for (const auto &key : fen_list) {
 
@@ -216,8 +613,7 @@ void explore(const fen_set_t::EmbeddedSet &fen_list, int depth,
 
     // probe DB
     std::vector<std::pair<std::string, int>> result =
-        cdbdirect_get(handle, board.getFen(false));
-    stats.gets++;
+        probe(handle, board, stats, index);
     size_t n_elements = result.size();
     int ply = result[n_elements - 1].second;
 
@@ -235,7 +631,8 @@ void explore(const fen_set_t::EmbeddedSet &fen_list, int depth,
       continue;
 
     if (fens_with_unseen) {
-      auto count_unseen = count_unseen_moves(board, result, handle, stats);
+      auto count_unseen =
+          count_unseen_moves(board, result, handle, stats, index);
       if (std::get<0>(count_unseen))
         fens_with_unseen->lazy_emplace_l(
             std::move(key), [](unseen_map_t::value_type &p) {},
@@ -290,7 +687,7 @@ void explore(const fen_set_t::EmbeddedSet &fen_list, int depth,
 
 size_t cdbsubtree(std::uintptr_t handle, std::string fen, int depth,
                   int maxCPLoss, unseen_map_t *fens_with_unseen,
-                  bool strict_subtree) {
+                  bool strict_subtree, SubtreeIndex *index) {
 
   std::cout << "Exploring fen: " << fen << std::endl;
   std::cout << "Max depth: " << depth << std::endl;
@@ -337,6 +734,7 @@ size_t cdbsubtree(std::uintptr_t handle, std::string fen, int depth,
   size_t total_gets = 0;
   size_t total_hits = 0;
   size_t total_nodes = 0;
+  size_t total_reused = 0;
   std::vector<size_t> total_counts(depth + 1, 0);
 
   auto total_t_start = std::chrono::high_resolution_clock::now();
@@ -417,12 +815,13 @@ size_t cdbsubtree(std::uintptr_t handle, std::string fen, int depth,
               pool.enqueue(
                   [&fens_currentDepth, &idepth, &handle, &stats, &visited_keys,
                    &fens_depthIndex, &fens_progressIndex, &maxCPLoss,
-                   &fens_with_unseen, &root_ply_depth](size_t i) {
+                   &fens_with_unseen, &root_ply_depth, &index](size_t i) {
                     fens_currentDepth.with_submap(
                         i, [&](const fen_set_t::EmbeddedSet &set) {
                           explore(set, idepth, handle, stats, visited_keys,
                                   fens_depthIndex, fens_progressIndex,
-                                  maxCPLoss, fens_with_unseen, root_ply_depth);
+                                  maxCPLoss, fens_with_unseen, root_ply_depth,
+                                  index);
                         });
                   },
                   i);
@@ -462,6 +861,10 @@ size_t cdbsubtree(std::uintptr_t handle, std::string fen, int depth,
         total_hits += stats.hits;
         size_t total_hitss = size_t(total_hits / total_elapsed_time_sec);
 
+        size_t iter_reuseds = size_t(stats.reused / elapsed_time_sec);
+        total_reused += stats.reused;
+        size_t total_reuseds = size_t(total_reused / total_elapsed_time_sec);
+
         size_t iter_nodess = size_t(stats.nodes / elapsed_time_sec);
         total_nodes += stats.nodes;
         size_t total_nodess = size_t(total_nodes / total_elapsed_time_sec);
@@ -506,6 +909,17 @@ size_t cdbsubtree(std::uintptr_t handle, std::string fen, int depth,
                   << std::setw(18) << iter_getss << std::setw(18) << total_gets
                   << std::setw(18) << total_getss << std::endl;
 
+        if (index) {
+          std::cout << std::setw(4) << "  " << std::setw(18) << "iter reused"
+                    << std::setw(18) << "iter reused/s" << std::setw(18)
+                    << "total reused" << std::setw(18) << "total reused/s"
+                    << std::endl;
+          std::cout << std::setw(4) << "  " << std::setw(18) << stats.reused
+                    << std::setw(18) << iter_reuseds << std::setw(18)
+                    << total_reused << std::setw(18) << total_reuseds
+                    << std::endl;
+        }
+
         std::cout << std::setw(4) << "  " << std::setw(18) << "iter DB hits"
                   << std::setw(18) << "iter DB hits/s" << std::setw(18)
                   << "total DB hits" << std::setw(18) << "total DB hits/s"
@@ -574,12 +988,45 @@ int main(int argc, char const *argv[]) {
   bool strict_subtree = find_argument(args, pos, "--strictSubTree", true);
   unseen_map_t *fens_with_unseen = uncover ? new unseen_map_t : NULL;
 
+  SubtreeIndex *index = NULL;
+  if (find_argument(args, pos, "--loadIndex")) {
+    index = new SubtreeIndex;
+    if (!index->load(*std::next(pos))) {
+      std::cout << "Could not load index " << *std::next(pos) << std::endl;
+      return 1;
+    }
+    std::cout << "Loaded index " << *std::next(pos) << std::endl;
+    if (find_argument(args, pos, "--changedKeys")) {
+      auto n_changed = index->load_changed(*std::next(pos));
+      if (!n_changed) {
+        std::cout << "Could not read changed keys " << *std::next(pos)
+                  << std::endl;
+        return 1;
+      }
+      std::cout << "Re-probing " << *n_changed << " changed positions"
+                << std::endl;
+    }
+  } else if (find_argument(args, pos, "--changedKeys")) {
+    std::cout << "--changedKeys requires --loadIndex" << std::endl;
+    return 1;
+  }
+  std::string save_index;
+  if (find_argument(args, pos, "--saveIndex")) {
+    save_index = *std::next(pos);
+    if (!index)
+      index = new SubtreeIndex;
+    if (!index->start_saving(save_index)) {
+      std::cout << "Could not write index " << save_index << std::endl;
+      return 1;
+    }
+  }
+
   std::cout << "Opening DB" << std::endl;
   std::uintptr_t handle = cdbdirect_initialize(CHESSDB_PATH);
 
   if (!allmoves) {
     size_t total_assigned = cdbsubtree(handle, fen, depth, maxCPLoss,
-                                       fens_with_unseen, strict_subtree);
+                                       fens_with_unseen, strict_subtree, index);
     std::cout << "Done analysing subtree of " << fen << " to depth " << depth
               << ":" << std::endl;
     std::cout << "Found " << total_assigned << " nodes";
@@ -606,7 +1053,7 @@ int main(int argc, char const *argv[]) {
       unseen_map_t *local_fens_with_unseen = uncover ? new unseen_map_t : NULL;
       size_t total_assigned =
           cdbsubtree(handle, fen, depth, maxCPLoss, local_fens_with_unseen,
-                     strict_subtree);
+                     strict_subtree, index);
       std::cout.rdbuf(old);
       std::cout << "    " << uci::moveToUci(m) << " : " << total_assigned
                 << " nodes";
@@ -649,8 +1096,24 @@ int main(int argc, char const *argv[]) {
       std::cout << "For " << improved << " of these positions, an unseen edge would be a new best move." << std::endl;
   }
 
+  int status = 0;
+  if (index) {
+    if (index->is_saving()) {
+      auto count = index->save();
+      if (count)
+        std::cout << "Saved index of " << *count << " positions in "
+                  << save_index << "." << std::endl;
+      else {
+        std::cout << "Could not write index " << save_index << "!"
+                  << std::endl;
+        status = 1;
+      }
+    }
+    delete index;
+  }
+
   std::cout << "Closing DB" << std::endl;
   handle = cdbdirect_finalize(handle);
 
-  return 0;
+  return status;
 }